@@ -26,6 +26,7 @@
 
 #ifndef QSLOG_H
 #define QSLOG_H
+#include <atomic>
 #include <sstream>
 #include <thread>
 #include "QsLogLevel.h"
@@ -36,11 +37,17 @@
 #include "l_logger_global.h"
 #define QS_LOG_VERSION "2.0b1"
 
+//! Statements below this level are compiled out entirely, e.g. QS_LOG_MIN_LEVEL=2 drops trace and debug
+#ifndef QS_LOG_MIN_LEVEL
+#define QS_LOG_MIN_LEVEL 0
+#endif
+
 namespace QsLogging
 {
 class Destination;
 typedef QVector<DestinationPtr> DestinationList;
 class LoggerImpl; // d pointer
+struct LogRecord;
 
 
 
@@ -56,9 +63,32 @@ public:
     void setLoggingLevel(Level newLevel);
     //! The default level is INFO
     Level loggingLevel() const;
+    //! Lock free check used by the QLOG_* macros before anything gets formatted
+    bool isLevelEnabled(Level messageLevel) const
+    {
+        return messageLevel >= cachedLevel.load(std::memory_order_relaxed);
+    }
+    //! The An<Logger> singleton, resolved once
+    static Logger& instance();
     void clearDestinationQueues();
     DestinationList GetDestinations();
     void ResetDestinations();
+
+    //! What happens to a message when the QS_LOG_SEPARATE_THREAD queue is full
+    enum OverflowPolicy
+    {
+        BlockOnOverflow, // wait for the writer thread to free a slot
+        DropOnOverflow   // discard the message and count it
+    };
+    void setOverflowPolicy(OverflowPolicy policy);
+    //! Messages discarded with DropOnOverflow since startup
+    quint64 droppedMessageCount() const;
+    //! Blocks until everything logged so far has been handed to the destinations
+    //! and the destinations have flushed their buffers, or until timeoutInMs runs out.
+    //! Returns false on timeout, e.g. when a destination is stuck on a full disk.
+    //! Meant for shutdown paths and crash handlers, but takes locks and allocates,
+    //! so it is not async-signal-safe: call it from a handler that runs on a normal thread.
+    bool flush(int timeoutInMs = 2000);
     //! The helper forwards the streaming to QDebug and builds the final
     //! log message.
     Logger();
@@ -84,15 +114,27 @@ public:
 
     ~Logger();
 private:
-    void enqueueWrite(const QString& message, Level level);
+    void enqueueWrite(QString message, Level level);
     void write(const QString& message, Level level);
-    friend class LogWriterRunnable;
+    void writeBatch(const LogRecord* records, int count);
+    void flushDestinations();
+    void flushExpiredDestinations();
+    void startTimedFlushIfNeeded(const Destination& destination);
+    friend class LogWriterThread;
+    friend class DelayedFlushThread;
 protected:
     LoggerImpl* d;
+    std::atomic<int> cachedLevel{InfoLevel};
 };
 } // end namespace
 BIND_TO_SELF_SINGLE(QsLogging::Logger)
 
+inline QsLogging::Logger& QsLogging::Logger::instance()
+{
+    static Logger* logger = An<Logger>().getData();
+    return *logger;
+}
+
 inline QString idToStr(std::thread::id id)
 {
     std::ostringstream ss;
@@ -103,40 +145,40 @@ inline QString idToStr(std::thread::id id)
 
 //! Logging macros: define QS_LOG_LINE_NUMBERS to get the file and line number
 //! in the log output.
+//! The level is checked before the Helper is created, so nothing streamed into a
+//! disabled statement is evaluated.
+#define QS_LOG_IS_ENABLED(level) \
+    ((level) >= QS_LOG_MIN_LEVEL && QsLogging::Logger::instance().isLevelEnabled(level))
+
 #ifndef QS_LOG_LINE_NUMBERS
-#define QLOG_TRACE() QsLogging::Logger::Helper(QsLogging::TraceLevel, An<QsLogging::Logger>().getData()).stream() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_DEBUG() QsLogging::Logger::Helper(QsLogging::DebugLevel, An<QsLogging::Logger>().getData()).stream() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_INFO() QsLogging::Logger::Helper(QsLogging::InfoLevel, An<QsLogging::Logger>().getData()).stream() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_WARN() QsLogging::Logger::Helper(QsLogging::WarnLevel, An<QsLogging::Logger>().getData()).stream() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_ERROR() QsLogging::Logger::Helper(QsLogging::ErrorLevel, An<QsLogging::Logger>().getData()).stream() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_FATAL() QsLogging::Logger::Helper(QsLogging::FatalLevel, An<QsLogging::Logger>().getData()).stream() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_TRACE_PURE() QsLogging::Logger::Helper(QsLogging::TraceLevel, An<QsLogging::Logger>().getData()).stream().noquote() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_DEBUG_PURE() QsLogging::Logger::Helper(QsLogging::DebugLevel, An<QsLogging::Logger>().getData()).stream().noquote() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_INFO_PURE() QsLogging::Logger::Helper(QsLogging::InfoLevel, An<QsLogging::Logger>().getData()).stream().noquote() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_WARN_PURE() QsLogging::Logger::Helper(QsLogging::WarnLevel, An<QsLogging::Logger>().getData()).stream().noquote() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_ERROR_PURE() QsLogging::Logger::Helper(QsLogging::ErrorLevel, An<QsLogging::Logger>().getData()).stream().noquote() << idToStr(std::this_thread::get_id())  << " "
-#define QLOG_FATAL_PURE() QsLogging::Logger::Helper(QsLogging::FatalLevel, An<QsLogging::Logger>().getData()).stream().noquote() << idToStr(std::this_thread::get_id())  << " "
+#define QS_LOG_STATEMENT(level) \
+    if (!QS_LOG_IS_ENABLED(level)) {} \
+    else QsLogging::Logger::Helper(level, &QsLogging::Logger::instance()).stream() << idToStr(std::this_thread::get_id())  << " "
+#define QS_LOG_STATEMENT_PURE(level) \
+    if (!QS_LOG_IS_ENABLED(level)) {} \
+    else QsLogging::Logger::Helper(level, &QsLogging::Logger::instance()).stream().noquote() << idToStr(std::this_thread::get_id())  << " "
 #else
-#define QLOG_TRACE() \
-    if (QsLogging::Logger::instance().loggingLevel() > QsLogging::TraceLevel) {} \
-    else  QsLogging::Logger::Helper(QsLogging::TraceLevel).stream() << __FILE__ << '@' << __LINE__
-#define QLOG_DEBUG() \
-    if (QsLogging::Logger::instance().loggingLevel() > QsLogging::DebugLevel) {} \
-    else QsLogging::Logger::Helper(QsLogging::DebugLevel).stream() << __FILE__ << '@' << __LINE__
-#define QLOG_INFO()  \
-    if (QsLogging::Logger::instance().loggingLevel() > QsLogging::InfoLevel) {} \
-    else QsLogging::Logger::Helper(QsLogging::InfoLevel).stream() << __FILE__ << '@' << __LINE__
-#define QLOG_WARN()  \
-    if (QsLogging::Logger::instance().loggingLevel() > QsLogging::WarnLevel) {} \
-    else QsLogging::Logger::Helper(QsLogging::WarnLevel).stream() << __FILE__ << '@' << __LINE__
-#define QLOG_ERROR() \
-    if (QsLogging::Logger::instance().loggingLevel() > QsLogging::ErrorLevel) {} \
-    else QsLogging::Logger::Helper(QsLogging::ErrorLevel).stream() << __FILE__ << '@' << __LINE__
-#define QLOG_FATAL() \
-    if (QsLogging::Logger::instance().loggingLevel() > QsLogging::FatalLevel) {} \
-    else QsLogging::Logger::Helper(QsLogging::FatalLevel).stream() << __FILE__ << '@' << __LINE__
+#define QS_LOG_STATEMENT(level) \
+    if (!QS_LOG_IS_ENABLED(level)) {} \
+    else QsLogging::Logger::Helper(level, &QsLogging::Logger::instance()).stream() << __FILE__ << '@' << __LINE__
+#define QS_LOG_STATEMENT_PURE(level) \
+    if (!QS_LOG_IS_ENABLED(level)) {} \
+    else QsLogging::Logger::Helper(level, &QsLogging::Logger::instance()).stream().noquote() << __FILE__ << '@' << __LINE__
 #endif
 
+#define QLOG_TRACE() QS_LOG_STATEMENT(QsLogging::TraceLevel)
+#define QLOG_DEBUG() QS_LOG_STATEMENT(QsLogging::DebugLevel)
+#define QLOG_INFO() QS_LOG_STATEMENT(QsLogging::InfoLevel)
+#define QLOG_WARN() QS_LOG_STATEMENT(QsLogging::WarnLevel)
+#define QLOG_ERROR() QS_LOG_STATEMENT(QsLogging::ErrorLevel)
+#define QLOG_FATAL() QS_LOG_STATEMENT(QsLogging::FatalLevel)
+#define QLOG_TRACE_PURE() QS_LOG_STATEMENT_PURE(QsLogging::TraceLevel)
+#define QLOG_DEBUG_PURE() QS_LOG_STATEMENT_PURE(QsLogging::DebugLevel)
+#define QLOG_INFO_PURE() QS_LOG_STATEMENT_PURE(QsLogging::InfoLevel)
+#define QLOG_WARN_PURE() QS_LOG_STATEMENT_PURE(QsLogging::WarnLevel)
+#define QLOG_ERROR_PURE() QS_LOG_STATEMENT_PURE(QsLogging::ErrorLevel)
+#define QLOG_FATAL_PURE() QS_LOG_STATEMENT_PURE(QsLogging::FatalLevel)
+
 #ifdef QS_LOG_DISABLE
 #include "QsLogDisableForThisFile.h"
 #endif
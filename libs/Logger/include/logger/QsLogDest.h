@@ -31,17 +31,44 @@
 #include <QtGlobal>
 #include "l_logger_global.h"
 class QString;
+class QByteArray;
 
 namespace QsLogging
 {
 
+//! Controls when a buffering destination hands its data to the OS.
+//! The default flushes after every message.
+struct FlushPolicy
+{
+    qint64 bufferSizeInBytes = 0;   // flush once this much is pending, 0 = after every message
+    int maxDelayInMs = 1000;        // flush when the oldest pending message is this old, checked on write and by the logger's timer
+    Level immediateLevel = ErrorLevel; // messages at or above this level are flushed right away
+};
+
+//! Rotation settings on top of the size limit passed to the factories
+struct RotationPolicy
+{
+    int rotateEverySeconds = 0;   // also rotate once the file has been written to for this long, 0 = size only
+    bool compressBackups = false; // store backups gzip-ed as <file>.X.gz
+};
+
 class L_LOGGERSHARED_EXPORT Destination
 {
 public:
     virtual ~Destination(){}
     virtual void write(const QString& message, Level level, Level currentLoggingLevel) = 0;
+    //! What the logger calls. utf8Message is message encoded once for all destinations,
+    //! byte oriented sinks should override this one. By default forwards to the QString version
+    virtual void write(const QString& message, const QByteArray& utf8Message, Level level, Level currentLoggingLevel);
     virtual bool isValid() = 0; // returns whether the destination was created correctly
     virtual void clearQueue();
+    //! pushes out anything the destination holds back, used on shutdown and by Logger::flush()
+    virtual void flush();
+    //! called periodically by the logger, flushes only what has been pending longer than the policy allows
+    virtual void flushExpired();
+    //! whether this destination holds lines back and needs flushExpired() calls, the logger
+    //! only starts its flush timer once such a destination is added
+    virtual bool needsTimedFlush() const;
 };
 typedef QSharedPointer<Destination> DestinationPtr;
 
@@ -54,12 +81,16 @@ public:
     static DestinationPtr MakeFileDestination(const QString& filePath,
                                               bool enableRotation = false,
                                               qint64 sizeInBytesToRotateAfter = 0,
-                                              int oldLogsToKeep = 0
+                                              int oldLogsToKeep = 0,
+                                              const FlushPolicy& flushPolicy = FlushPolicy(),
+                                              const RotationPolicy& rotationPolicy = RotationPolicy()
                                               );
     static DestinationPtr MakeErrDumpDestination(const QString& filePath,
                                                  bool enableRotation,
                                                  qint64 sizeInBytesToRotateAfter,
-                                                 int oldLogsToKeep);
+                                                 int oldLogsToKeep,
+                                                 const FlushPolicy& flushPolicy = FlushPolicy(),
+                                                 const RotationPolicy& rotationPolicy = RotationPolicy());
     static DestinationPtr MakeDebugOutputDestination();
 };
 
@@ -27,9 +27,11 @@
 #define QSLOGDESTFILE_H
 
 #include "QsLogDest.h"
+#include <QByteArray>
+#include <QElapsedTimer>
 #include <QFile>
-#include <QStringList>
-#include <QTextStream>
+#include <QList>
+#include <QThreadPool>
 #include <QtGlobal>
 #include <QSharedPointer>
 #include "l_logger_global.h"
@@ -41,7 +43,8 @@ public:
     virtual ~RotationStrategy() = default;
 
     virtual void setInitialInfo(const QFile &file) = 0;
-    virtual void includeMessageInCalculation(const QString &message) = 0;
+    //! size of the message as it is written to the file, UTF-8 and newline included
+    virtual void includeMessageInCalculation(qint64 messageSizeInBytes) = 0;
     virtual bool shouldRotate() = 0;
     virtual void rotate() = 0;
     virtual QIODevice::OpenMode recommendedOpenModeFlag() = 0;
@@ -52,34 +55,51 @@ class NullRotationStrategy : public RotationStrategy
 {
 public:
     virtual void setInitialInfo(const QFile &) {}
-    virtual void includeMessageInCalculation(const QString &) {}
+    virtual void includeMessageInCalculation(qint64) {}
     virtual bool shouldRotate() { return false; }
     virtual void rotate() {}
     virtual QIODevice::OpenMode recommendedOpenModeFlag() { return QIODevice::Append; }
 };
 
-// Rotates after a size is reached, keeps a number of <= 10 backups, appends to existing file.
+// Rotates after a size is reached and/or after a time interval, keeps a number of <= 10 backups,
+// appends to existing file. Backups are shifted (and optionally compressed) on a background thread.
 class SizeRotationStrategy : public RotationStrategy
 {
 public:
     SizeRotationStrategy(bool rotateOnInit = false);
+    ~SizeRotationStrategy() override;
     static const int MaxBackupCount;
 
     virtual void setInitialInfo(const QFile &file);
-    virtual void includeMessageInCalculation(const QString &message);
+    virtual void includeMessageInCalculation(qint64 messageSizeInBytes);
     virtual bool shouldRotate();
     virtual void rotate();
     virtual QIODevice::OpenMode recommendedOpenModeFlag();
 
+    //! 0 disables rotation by size
     void setMaximumSizeInBytes(qint64 size);
     void setBackupCount(int backups);
+    //! rotate once the current file has been written to for this long, 0 disables it
+    void setRotationIntervalInSeconds(int seconds);
+    //! backups are stored gzip-ed as filename.X.gz
+    void setCompressBackups(bool compress);
 
 private:
+    void queueLeftoverSegments();
+
     QString mFileName;
     qint64 mCurrentSizeInBytes = 0;
     qint64 mMaxSizeInBytes = 0;
     int mBackupsCount;
     bool rotateOnInit = false;
+    qint64 mRotationIntervalInSeconds = 0;
+    QElapsedTimer mSegmentTimer;
+    qint64 mSegmentAgeAtOpenInMs = 0; // the file may have been started by an earlier run
+    bool mRotationFailed = false;
+    bool mCompressBackups = false;
+    int mRotationCounter = 0;
+    bool mLeftoversQueued = false;
+    QThreadPool mBackupWorker;
 };
 
 typedef QSharedPointer<RotationStrategy> RotationStrategyPtr;
@@ -88,28 +108,49 @@ typedef QSharedPointer<RotationStrategy> RotationStrategyPtr;
 class FileDestination : public Destination
 {
 public:
-    FileDestination(const QString& filePath, RotationStrategyPtr rotationStrategy);
+    FileDestination(const QString& filePath, RotationStrategyPtr rotationStrategy,
+                    const FlushPolicy& flushPolicy = FlushPolicy());
+    ~FileDestination() override;
     virtual void write(const QString& message, Level level, Level currentLoggingLevel);
+    void write(const QString& message, const QByteArray& utf8Message, Level level, Level currentLoggingLevel) override;
     virtual void close(const QString& message, Level level);
     void Rotate();
     virtual bool isValid();
+    void flush() override;
+    void flushExpired() override;
+    bool needsTimedFlush() const override;
 
 protected:
+    bool openFile();
+    void rotateIfNeeded(qint64 incomingSizeInBytes);
+    //! the file has to be closed while the strategy moves it and reopened afterwards
+    void rotateNow();
+    //! adds the line to the pending buffer, nothing reaches the file until flush()
+    void appendLine(const QByteArray& utf8Message);
+    //! flushes if the policy says so
+    void flushIfNeeded(Level level);
+
     QFile mFile;
-    QTextStream mOutputStream;
+    QByteArray mBuffer;
     QSharedPointer<RotationStrategy> mRotationStrategy;
+    FlushPolicy mFlushPolicy;
+    QElapsedTimer mSinceFirstUnflushed;
 };
 
 // sink that dumps full diagnostic for current cycle once error occurs
 class ErrDumpDestination : public FileDestination
 {
 public:
-    ErrDumpDestination(const QString& filePath, RotationStrategyPtr rotationStrategy) : FileDestination(filePath, rotationStrategy){}
+    ErrDumpDestination(const QString& filePath, RotationStrategyPtr rotationStrategy,
+                       const FlushPolicy& flushPolicy = FlushPolicy()) : FileDestination(filePath, rotationStrategy, flushPolicy){}
+    // the logger writes through the inherited FileDestination overloads, the dump only
+    // happens when this overload is called directly
+    using FileDestination::write;
     virtual void write(const QString& message, Level level);
     virtual void clearQueue() override;
 
 protected:
-    QStringList queue;
+    QList<QByteArray> queue;
 };
 
 }
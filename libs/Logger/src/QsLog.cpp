@@ -25,9 +25,13 @@
 
 #include "QsLog.h"
 #include "QsLogDest.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #ifdef QS_LOG_SEPARATE_THREAD
-#include <QThreadPool>
-#include <QRunnable>
+#include <atomic>
+#include <memory>
+#include <vector>
 #else
 #include <QMutex>
 #endif
@@ -36,7 +40,9 @@
 #include <QtGlobal>
 #include <QReadWriteLock>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
+#include <ctime>
 #include <stdexcept>
 #include "Tracer.h"
 
@@ -45,6 +51,7 @@ namespace QsLogging
 {
 // not using Qt::ISODate because we need the milliseconds too
 //static const QString fmtDateTime("dd hh:mm:ss.zzz");
+static const int timestampLength = 15;
 
 static inline QString LevelToText(Level theLevel)
 {
@@ -70,22 +77,317 @@ static inline QString LevelToText(Level theLevel)
     }
 }
 
+//! Wall clock in milliseconds. Prefers the coarse clock where there is one,
+//! it is a plain memory read instead of a timer query
+static inline qint64 CoarseMSecsSinceEpoch()
+{
+#if defined(Q_OS_LINUX)
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return qint64(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+#else
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//! Appends "dd hh:mm:ss.zzz". The part up to the seconds is kept per thread
+//! and only goes through QDateTime formatting when the second changes
+static void AppendTimestamp(QString& line)
+{
+    struct SecondCache
+    {
+        qint64 second = -1;
+        QString text; // "dd hh:mm:ss."
+    };
+    thread_local SecondCache cache;
+
+    const qint64 msecs = CoarseMSecsSinceEpoch();
+    const qint64 second = msecs / 1000;
+    if (second != cache.second) {
+        cache.second = second;
+        cache.text = QDateTime::fromMSecsSinceEpoch(second * 1000, Qt::UTC).toString(QStringLiteral("dd hh:mm:ss."));
+    }
+    const int millis = static_cast<int>(msecs % 1000);
+    line += cache.text;
+    line += QLatin1Char(static_cast<char>('0' + millis / 100));
+    line += QLatin1Char(static_cast<char>('0' + millis / 10 % 10));
+    line += QLatin1Char(static_cast<char>('0' + millis % 10));
+}
+
+struct LogRecord
+{
+    QString message;
+    Level level = InfoLevel;
+};
+
 #ifdef QS_LOG_SEPARATE_THREAD
-class LogWriterRunnable : public QRunnable
+// must be a power of two
+#ifndef QS_LOG_QUEUE_CAPACITY
+#define QS_LOG_QUEUE_CAPACITY 8192
+#endif
+static_assert((QS_LOG_QUEUE_CAPACITY & (QS_LOG_QUEUE_CAPACITY - 1)) == 0,
+              "QS_LOG_QUEUE_CAPACITY must be a power of two");
+
+//! Bounded multi producer, single consumer queue over preallocated slots.
+//! Each slot carries a sequence number that tells whether it is free for
+//! the producer at a given position or ready for the consumer, so pushing
+//! is one CAS on the write position and popping needs no atomics RMW at all.
+class LogRingBuffer
+{
+public:
+    LogRingBuffer() : cells(new Cell[QS_LOG_QUEUE_CAPACITY])
+    {
+        for (size_t i = 0; i < QS_LOG_QUEUE_CAPACITY; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    //! on success message is swapped into the slot and left empty
+    bool tryPush(QString& message, Level level)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        for (;;) {
+            cell = &cells[pos & mask];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false; // full
+            else
+                pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+        cell->record.message.swap(message);
+        cell->record.level = level;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! consumer side, only ever called from the writer thread
+    bool tryPop(LogRecord& record)
+    {
+        Cell& cell = cells[dequeuePos & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1)
+            return false;
+        record.message.swap(cell.record.message);
+        record.level = cell.record.level;
+        cell.record.message.clear();
+        cell.sequence.store(dequeuePos + QS_LOG_QUEUE_CAPACITY, std::memory_order_release);
+        ++dequeuePos;
+        return true;
+    }
+
+    //! consumer side
+    bool isEmpty() const
+    {
+        return cells[dequeuePos & mask].sequence.load(std::memory_order_acquire) != dequeuePos + 1;
+    }
+
+    //! amount of successful pushes so far, used as a flush target
+    size_t pushedCount() const
+    {
+        return enqueuePos.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence{0};
+        LogRecord record;
+    };
+    static const size_t mask = QS_LOG_QUEUE_CAPACITY - 1;
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) size_t dequeuePos = 0;
+};
+
+//! Owns the queue and the single thread that drains it into the destinations.
+//! Records are handed over in batches so the logger lock is taken once per batch.
+class LogWriterThread
+{
+public:
+    explicit LogWriterThread(Logger* logger) : logger(logger)
+    {
+        thread = std::thread([this]{ run(); });
+    }
+    ~LogWriterThread()
+    {
+        stop();
+    }
+
+    void push(QString& message, Level level)
+    {
+        // writing from a destination or after shutdown must not wait on the queue
+        if (stopping.load(std::memory_order_acquire) || isWriterThread()) {
+            logger->write(message, level);
+            return;
+        }
+        if (!queue.tryPush(message, level)) {
+            if (overflowPolicy.load(std::memory_order_relaxed) == Logger::DropOnOverflow) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            do {
+                wakeWriter();
+                std::this_thread::yield();
+            } while (!queue.tryPush(message, level));
+        }
+        // pairs with the fence in run(): either we see the writer asleep or it sees our record
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (writerSleeping.load(std::memory_order_relaxed))
+            wakeWriter();
+    }
+
+    //! false if the writer didn't catch up before the deadline, e.g. stuck in a destination
+    bool flush(std::chrono::steady_clock::time_point deadline)
+    {
+        if (isWriterThread())
+            return true;
+        const size_t target = queue.pushedCount();
+        while (written.load(std::memory_order_acquire) < target && !stopping.load(std::memory_order_acquire)) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return false;
+            wakeWriter();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    //! drains whatever is still queued before returning
+    void stop()
+    {
+        if (!thread.joinable())
+            return;
+        stopping.store(true, std::memory_order_release);
+        wakeWriter();
+        thread.join();
+        // a producer could have slipped in between the writer's last check and the join
+        LogRecord record;
+        while (queue.tryPop(record))
+            logger->writeBatch(&record, 1);
+    }
+
+    std::atomic<int> overflowPolicy{Logger::BlockOnOverflow};
+    std::atomic<quint64> dropped{0};
+
+private:
+    static const int batchSize = 256;
+
+    //! thread.get_id() would race with join() in stop()
+    bool isWriterThread() const
+    {
+        return std::this_thread::get_id() == writerId.load(std::memory_order_acquire);
+    }
+
+    void wakeWriter()
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wakeCondition.notify_one();
+    }
+
+    void run()
+    {
+        writerId.store(std::this_thread::get_id(), std::memory_order_release);
+        std::vector<LogRecord> batch(batchSize);
+        for (;;) {
+            int count = 0;
+            while (count < batchSize && queue.tryPop(batch[count]))
+                ++count;
+            if (count > 0) {
+                logger->writeBatch(batch.data(), count);
+                for (int i = 0; i < count; ++i)
+                    batch[i].message.clear();
+                written.fetch_add(count, std::memory_order_release);
+                continue;
+            }
+            if (stopping.load(std::memory_order_acquire))
+                break;
+
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            writerSleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool idle = false;
+            if (queue.isEmpty() && !stopping.load(std::memory_order_relaxed))
+                idle = wakeCondition.wait_for(lock, std::chrono::milliseconds(100)) == std::cv_status::timeout;
+            writerSleeping.store(false, std::memory_order_relaxed);
+            // nothing arrived for a while, don't let buffering destinations sit on their data
+            if (idle && written.load(std::memory_order_relaxed) != flushedAt) {
+                lock.unlock();
+                flushedAt = written.load(std::memory_order_relaxed);
+                logger->flushDestinations();
+            }
+        }
+    }
+
+    Logger* logger;
+    LogRingBuffer queue;
+    std::atomic<size_t> written{0};
+    size_t flushedAt = 0; // writer thread only
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> writerSleeping{false};
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::atomic<std::thread::id> writerId{}; // set by the writer itself, never reset
+    std::thread thread;
+};
+#else
+//! Without the writer thread nothing runs once logging goes quiet, so a buffering
+//! destination could sit on its last lines forever. This wakes up periodically
+//! and lets destinations flush whatever has been pending longer than their policy allows.
+//! Only started once a destination that buffers is added, see Destination::needsTimedFlush()
+class DelayedFlushThread
 {
 public:
-    LogWriterRunnable(const QString &message, Level level)
-        : mMessage(message)
-        , mLevel(level) {}
+    explicit DelayedFlushThread(Logger* logger) : logger(logger)
+    {
+    }
+    ~DelayedFlushThread()
+    {
+        stop();
+    }
 
-    virtual void run()
+    //! called with the logger lock held, so never concurrently with itself
+    void start()
     {
-        Logger::instance().write(mMessage, mLevel);
+        if (thread.joinable())
+            return;
+        thread = std::thread([this]{ run(); });
+    }
+
+    void stop()
+    {
+        if (!thread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wakeCondition.notify_one();
+        thread.join();
     }
 
 private:
-    QString mMessage;
-    Level mLevel;
+    static const int checkIntervalInMs = 100;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (!wakeCondition.wait_for(lock, std::chrono::milliseconds(checkIntervalInMs), [this]{ return stopping; })) {
+            lock.unlock();
+            logger->flushExpiredDestinations();
+            lock.lock();
+        }
+    }
+
+    Logger* logger;
+    bool stopping = false;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::thread thread;
 };
 #endif
 
@@ -93,33 +395,42 @@ class LoggerImpl
 {
     friend class Logger;
 public:
-    LoggerImpl() :
-        logMutex(QReadWriteLock::Recursive),level(InfoLevel)
+    explicit LoggerImpl(Logger* logger) :
+        logMutex(QReadWriteLock::Recursive)
+#ifdef QS_LOG_SEPARATE_THREAD
+      , writer(logger)
+#else
+      , flusher(logger)
+#endif
     {
+        Q_UNUSED(logger)
         // assume at least file + console
         destList.reserve(2);
-#ifdef QS_LOG_SEPARATE_THREAD
-        threadPool.setMaxThreadCount(1);
-        threadPool.setExpiryTimeout(-1);
-#endif
     }
-#ifdef QS_LOG_SEPARATE_THREAD
-    QThreadPool threadPool;
-#else
-#endif
 private:
     DestinationList destList;
     QReadWriteLock logMutex;
-    Level level = InfoLevel;
+#ifdef QS_LOG_SEPARATE_THREAD
+    // declared last: destroyed first, so the queue is drained while destinations still exist
+    LogWriterThread writer;
+#else
+    DelayedFlushThread flusher;
+#endif
 };
 
 Logger::Logger() :
-    d(new LoggerImpl)
+    d(new LoggerImpl(this))
 {
 }
 
 Logger::~Logger()
 {
+#ifdef QS_LOG_SEPARATE_THREAD
+    d->writer.stop();
+#else
+    d->flusher.stop();
+#endif
+    flushDestinations();
     delete d;
 }
 
@@ -128,6 +439,7 @@ void Logger::addDestination(DestinationPtr destination)
     assert(destination.data());
     QWriteLocker lock(&d->logMutex);
     d->destList.push_back(destination);
+    startTimedFlushIfNeeded(*destination);
 }
 
 void Logger::replaceDestination(DestinationPtr destination)
@@ -136,6 +448,18 @@ void Logger::replaceDestination(DestinationPtr destination)
     QWriteLocker lock(&d->logMutex);
     d->destList.clear();
     d->destList.push_back(destination);
+    startTimedFlushIfNeeded(*destination);
+}
+
+//! the writer thread flushes on idle by itself, synchronous builds need the timer
+void Logger::startTimedFlushIfNeeded(const Destination& destination)
+{
+#ifdef QS_LOG_SEPARATE_THREAD
+    Q_UNUSED(destination)
+#else
+    if (destination.needsTimedFlush())
+        d->flusher.start();
+#endif
 }
 
 void Logger::clearDestinationList()
@@ -146,14 +470,12 @@ void Logger::clearDestinationList()
 
 void Logger::setLoggingLevel(Level newLevel)
 {
-    QWriteLocker lock(&d->logMutex);
-    d->level = newLevel;
+    cachedLevel.store(newLevel, std::memory_order_relaxed);
 }
 
 Level Logger::loggingLevel() const
 {
-    QReadLocker lock(&d->logMutex);
-    return d->level;
+    return static_cast<Level>(cachedLevel.load(std::memory_order_relaxed));
 }
 
 void Logger::clearDestinationQueues()
@@ -177,13 +499,72 @@ void Logger::ResetDestinations()
     d->destList.clear();
 }
 
+void Logger::setOverflowPolicy(OverflowPolicy policy)
+{
+#ifdef QS_LOG_SEPARATE_THREAD
+    d->writer.overflowPolicy.store(policy, std::memory_order_relaxed);
+#else
+    Q_UNUSED(policy)
+#endif
+}
+
+quint64 Logger::droppedMessageCount() const
+{
+#ifdef QS_LOG_SEPARATE_THREAD
+    return d->writer.dropped.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+bool Logger::flush(int timeoutInMs)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutInMs);
+#ifdef QS_LOG_SEPARATE_THREAD
+    if (!d->writer.flush(deadline))
+        return false;
+#endif
+    // a destination stuck in a write holds the lock, don't wait on it forever either
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    if (!d->logMutex.tryLockForWrite(static_cast<int>(qMax<qint64>(remaining.count(), 0))))
+        return false;
+    for(const auto& dest : qAsConst(d->destList))
+        dest->flush();
+    d->logMutex.unlock();
+    return true;
+}
+
+void Logger::flushDestinations()
+{
+    QWriteLocker lock(&d->logMutex);
+    for(const auto& dest : qAsConst(d->destList))
+        dest->flush();
+}
+
+void Logger::flushExpiredDestinations()
+{
+    QWriteLocker lock(&d->logMutex);
+    for(const auto& dest : qAsConst(d->destList))
+        dest->flushExpired();
+}
+
 //! creates the complete log message and passes it to the logger
 void Logger::Helper::writeToLog()
 {
-    if(writeServiceInfo)
-        loggerInstance->enqueueWrite(LevelToText(level) + " " + QDateTime::currentDateTimeUtc().toString("dd hh:mm:ss.zzz") + " " + buffer, level);
-    else
+    if(!writeServiceInfo)
+    {
         loggerInstance->enqueueWrite(buffer, level);
+        return;
+    }
+    const QString levelText = LevelToText(level);
+    QString line;
+    line.reserve(levelText.size() + timestampLength + buffer.size() + 2);
+    line += levelText;
+    line += QLatin1Char(' ');
+    AppendTimestamp(line);
+    line += QLatin1Char(' ');
+    line += buffer;
+    loggerInstance->enqueueWrite(std::move(line), level);
 }
 
 Logger::Helper::Helper(Level logLevel, Logger *_loggerInstance, bool _writeServiceInfo) :
@@ -209,14 +590,12 @@ Logger::Helper::~Helper()
     }
 }
 
-//! directs the message to the task queue or writes it directly
-void Logger::enqueueWrite(const QString& message, Level level)
+//! directs the message to the writer queue or writes it directly
+void Logger::enqueueWrite(QString message, Level level)
 {
 #ifdef QS_LOG_SEPARATE_THREAD
-    LogWriterRunnable *r = new LogWriterRunnable(message, level);
-    d->threadPool.start(r);
+    d->writer.push(message, level);
 #else
-
     write(message, level);
 #endif
 }
@@ -226,9 +605,24 @@ void Logger::enqueueWrite(const QString& message, Level level)
 void Logger::write(const QString& message, Level level)
 {
     QWriteLocker lock(&d->logMutex);
+    const Level currentLevel = loggingLevel();
+    const QByteArray utf8Message = message.toUtf8();
     for (auto it = d->destList.cbegin(), endIt = d->destList.cend(); it != endIt;++it)
     {
-            (*it)->write(message, level, d->level);
+            (*it)->write(message, utf8Message, level, currentLevel);
+    }
+}
+
+//! Same as write() for a run of queued messages, taking the lock only once
+void Logger::writeBatch(const LogRecord* records, int count)
+{
+    QWriteLocker lock(&d->logMutex);
+    const Level currentLevel = loggingLevel();
+    for (int i = 0; i < count; ++i)
+    {
+        const QByteArray utf8Message = records[i].message.toUtf8();
+        for (auto it = d->destList.cbegin(), endIt = d->destList.cend(); it != endIt;++it)
+            (*it)->write(records[i].message, utf8Message, records[i].level, currentLevel);
     }
 }
 
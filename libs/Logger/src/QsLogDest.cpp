@@ -26,6 +26,7 @@
 #include "QsLogDest.h"
 #include "QsLogDestConsole.h"
 #include "QsLogDestFile.h"
+#include <QByteArray>
 #include <QString>
 
 namespace QsLogging
@@ -50,31 +51,39 @@ DestinationPtr DestinationFactory::MakeSingleFileDestination(const QString& file
 DestinationPtr DestinationFactory::MakeFileDestination(const QString& filePath,
                                                        bool enableRotation,
                                                        qint64 sizeInBytesToRotateAfter,
-                                                       int oldLogsToKeep
+                                                       int oldLogsToKeep,
+                                                       const FlushPolicy& flushPolicy,
+                                                       const RotationPolicy& rotationPolicy
                                                        )
 {
     if (enableRotation) {
         QScopedPointer<SizeRotationStrategy> logRotation(new SizeRotationStrategy());
         logRotation->setMaximumSizeInBytes(sizeInBytesToRotateAfter);
         logRotation->setBackupCount(oldLogsToKeep);
+        logRotation->setRotationIntervalInSeconds(rotationPolicy.rotateEverySeconds);
+        logRotation->setCompressBackups(rotationPolicy.compressBackups);
 
-        return DestinationPtr(new FileDestination(filePath, RotationStrategyPtr(logRotation.take())));
+        return DestinationPtr(new FileDestination(filePath, RotationStrategyPtr(logRotation.take()), flushPolicy));
     }
 
-    return DestinationPtr(new FileDestination(filePath, RotationStrategyPtr(new NullRotationStrategy)));
+    return DestinationPtr(new FileDestination(filePath, RotationStrategyPtr(new NullRotationStrategy), flushPolicy));
 }
 DestinationPtr DestinationFactory::MakeErrDumpDestination(const QString& filePath, bool enableRotation,
-                                                       qint64 sizeInBytesToRotateAfter, int oldLogsToKeep)
+                                                       qint64 sizeInBytesToRotateAfter, int oldLogsToKeep,
+                                                       const FlushPolicy& flushPolicy,
+                                                       const RotationPolicy& rotationPolicy)
 {
     if (enableRotation) {
         QScopedPointer<SizeRotationStrategy> logRotation(new SizeRotationStrategy);
         logRotation->setMaximumSizeInBytes(sizeInBytesToRotateAfter);
         logRotation->setBackupCount(oldLogsToKeep);
+        logRotation->setRotationIntervalInSeconds(rotationPolicy.rotateEverySeconds);
+        logRotation->setCompressBackups(rotationPolicy.compressBackups);
 
-        return DestinationPtr(new ErrDumpDestination(filePath, RotationStrategyPtr(logRotation.take())));
+        return DestinationPtr(new ErrDumpDestination(filePath, RotationStrategyPtr(logRotation.take()), flushPolicy));
     }
 
-    return DestinationPtr(new ErrDumpDestination(filePath, RotationStrategyPtr(new NullRotationStrategy)));
+    return DestinationPtr(new ErrDumpDestination(filePath, RotationStrategyPtr(new NullRotationStrategy), flushPolicy));
 }
 
 DestinationPtr DestinationFactory::MakeDebugOutputDestination()
@@ -82,9 +91,30 @@ DestinationPtr DestinationFactory::MakeDebugOutputDestination()
     return DestinationPtr(new DebugOutputDestination);
 }
 
+void Destination::write(const QString& message, const QByteArray& utf8Message, Level level, Level currentLoggingLevel)
+{
+    Q_UNUSED(utf8Message)
+    write(message, level, currentLoggingLevel);
+}
+
 void Destination::clearQueue()
 {
     // intentionally nothing
 }
 
+void Destination::flush()
+{
+    // intentionally nothing
+}
+
+void Destination::flushExpired()
+{
+    // intentionally nothing
+}
+
+bool Destination::needsTimedFlush() const
+{
+    return false;
+}
+
 } // end namespace
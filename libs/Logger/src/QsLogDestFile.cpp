@@ -25,56 +25,109 @@
 
 #include "QsLogDestFile.h"
 #include "QsLog.h"
-#include <QTextCodec>
 #include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QStringList>
 #include <QtGlobal>
+#include <algorithm>
 #include <iostream>
+#include <utility>
+#include <zlib.h>
 
 const int QsLogging::SizeRotationStrategy::MaxBackupCount = 10;
 
-
-QsLogging::SizeRotationStrategy::SizeRotationStrategy(bool _rotateOnInit)
-    : mCurrentSizeInBytes(0)
-    , mMaxSizeInBytes(0)
-    , mBackupsCount(0)
-    , rotateOnInit(_rotateOnInit)
-
+namespace
 {
-}
-
-void QsLogging::SizeRotationStrategy::setInitialInfo(const QFile &file)
+// Streams the file through zlib chunk by chunk, a rotated segment can be hundreds of megabytes
+bool CompressFile(const QString& sourceName, const QString& targetName)
 {
-    mFileName = file.fileName();
-    mCurrentSizeInBytes = file.size();
+    QFile source(sourceName);
+    if (!source.open(QIODevice::ReadOnly))
+        return false;
+    QFile target(targetName);
+    if (!target.open(QIODevice::WriteOnly))
+        return false;
+
+    z_stream stream = {};
+    // 15 + 16 window bits selects the gzip wrapper, so backups open with zcat and friends
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    const int chunkSize = 256 * 1024;
+    QByteArray input(chunkSize, Qt::Uninitialized);
+    QByteArray output(chunkSize, Qt::Uninitialized);
+    bool succeeded = true;
+    int flushMode = Z_NO_FLUSH;
+    while (succeeded && flushMode != Z_FINISH) {
+        const qint64 read = source.read(input.data(), chunkSize);
+        if (read < 0) {
+            succeeded = false;
+            break;
+        }
+        flushMode = source.atEnd() ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef*>(input.data());
+        stream.avail_in = static_cast<uInt>(read);
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(output.data());
+            stream.avail_out = chunkSize;
+            deflate(&stream, flushMode);
+            const qint64 produced = chunkSize - stream.avail_out;
+            if (target.write(output.constData(), produced) != produced) {
+                succeeded = false;
+                break;
+            }
+        } while (stream.avail_out == 0);
+    }
+    deflateEnd(&stream);
+    source.close();
+    target.close();
+
+    if (!succeeded) {
+        QFile::remove(targetName);
+        return false;
+    }
+    return QFile::remove(sourceName);
 }
 
-void QsLogging::SizeRotationStrategy::includeMessageInCalculation(const QString &message)
+// How long ago the segment in an existing log started, so that restarting the process
+// doesn't restart the rotation interval. Falls back to mtime where there is no birth time
+qint64 SegmentAgeInMs(const QFile& file)
 {
-    mCurrentSizeInBytes += message.toUtf8().size();
+    if (file.size() == 0)
+        return 0;
+    const QFileInfo info(file.fileName());
+    QDateTime startedAt = info.birthTime();
+    if (!startedAt.isValid())
+        startedAt = info.lastModified();
+    return qMax<qint64>(0, startedAt.msecsTo(QDateTime::currentDateTime()));
 }
 
-bool QsLogging::SizeRotationStrategy::shouldRotate()
+// rotate() names segments <file>.rotating.<msecs>.<counter>, suffix is the part after ".rotating."
+std::pair<qint64, int> RotationOrder(const QString& suffix)
 {
-    return mCurrentSizeInBytes > mMaxSizeInBytes || rotateOnInit;
+    const QStringList parts = suffix.split(QLatin1Char('.'));
+    return std::make_pair(parts.value(0).toLongLong(), parts.value(1).toInt());
 }
 
-// Algorithm assumes backups will be named filename.X, where 1 <= X <= mBackupsCount.
-// All X's will be shifted up.
-void QsLogging::SizeRotationStrategy::rotate()
+// Algorithm assumes backups will be named filename.X, where 1 <= X <= backupsCount.
+// All X's will be shifted up and the rotated out file becomes filename.1
+void ShiftBackups(const QString& fileName, const QString& rotatedName, int backupsCount, bool compress)
 {
-    if (!mBackupsCount) {
-        if (!QFile::remove(mFileName))
-            std::cerr << "QsLog: backup delete failed " << qPrintable(mFileName) << std::endl;
+    if (!backupsCount) {
+        if (!QFile::remove(rotatedName))
+            std::cerr << "QsLog: backup delete failed " << qPrintable(rotatedName) << std::endl;
         return;
     }
 
     // 1. find the last existing backup than can be shifted up
-    const QString logNamePattern = mFileName + QStringLiteral(".%1");
+    const QString logNamePattern = fileName + QStringLiteral(".%1") + (compress ? QStringLiteral(".gz") : QString());
     int lastExistingBackupIndex = 0;
-    for (int i = 1;i <= mBackupsCount;++i) {
+    for (int i = 1;i <= backupsCount;++i) {
         const QString backupFileName = logNamePattern.arg(i);
         if (QFile::exists(backupFileName))
-            lastExistingBackupIndex = qMin(i, mBackupsCount - 1);
+            lastExistingBackupIndex = qMin(i, backupsCount - 1);
         else
             break;
     }
@@ -91,15 +144,122 @@ void QsLogging::SizeRotationStrategy::rotate()
         }
     }
 
-    // 3. rename current log file
+    // 3. the rotated out log becomes the first backup
     const QString newName = logNamePattern.arg(1);
     if (QFile::exists(newName))
         QFile::remove(newName);
-    if (!QFile::rename(mFileName, newName)) {
-        std::cerr << "QsLog: could not rename log " << qPrintable(mFileName)
+    const bool moved = compress ? CompressFile(rotatedName, newName) : QFile::rename(rotatedName, newName);
+    if (!moved) {
+        std::cerr << "QsLog: could not move rotated log " << qPrintable(rotatedName)
                   << " to " << qPrintable(newName) << std::endl;
     }
+}
+
+class ShiftBackupsRunnable : public QRunnable
+{
+public:
+    ShiftBackupsRunnable(const QString& fileName, const QString& rotatedName, int backupsCount, bool compress)
+        : mFileName(fileName)
+        , mRotatedName(rotatedName)
+        , mBackupsCount(backupsCount)
+        , mCompress(compress) {}
+
+    void run() override
+    {
+        ShiftBackups(mFileName, mRotatedName, mBackupsCount, mCompress);
+    }
+
+private:
+    QString mFileName;
+    QString mRotatedName;
+    int mBackupsCount;
+    bool mCompress;
+};
+}
+
+QsLogging::SizeRotationStrategy::SizeRotationStrategy(bool _rotateOnInit)
+    : mCurrentSizeInBytes(0)
+    , mMaxSizeInBytes(0)
+    , mBackupsCount(0)
+    , rotateOnInit(_rotateOnInit)
+
+{
+    // one thread keeps the queued shifts in rotation order
+    mBackupWorker.setMaxThreadCount(1);
+}
+
+QsLogging::SizeRotationStrategy::~SizeRotationStrategy()
+{
+    mBackupWorker.waitForDone();
+}
+
+void QsLogging::SizeRotationStrategy::setInitialInfo(const QFile &file)
+{
+    mFileName = file.fileName();
+    mSegmentTimer.start();
+    if (mRotationFailed) {
+        // the log couldn't be moved away, treat it as a fresh segment so the next attempt
+        // comes after another full size or interval instead of on every message
+        mRotationFailed = false;
+        mCurrentSizeInBytes = 0;
+        mSegmentAgeAtOpenInMs = 0;
+    }
+    else {
+        mCurrentSizeInBytes = file.size();
+        mSegmentAgeAtOpenInMs = SegmentAgeInMs(file);
+    }
+    if (!mLeftoversQueued) {
+        mLeftoversQueued = true;
+        queueLeftoverSegments();
+    }
+}
+
+// Segments renamed by a previous run whose shift job never got to run, e.g. because the process exited.
+// Queued oldest first so they land in the backups in the order they were rotated out
+void QsLogging::SizeRotationStrategy::queueLeftoverSegments()
+{
+    const QFileInfo info(mFileName);
+    const QDir directory(info.absolutePath());
+    const QString prefix = info.fileName() + QStringLiteral(".rotating.");
+    QStringList leftovers = directory.entryList(QStringList() << prefix + QStringLiteral("*"), QDir::Files);
+    std::sort(leftovers.begin(), leftovers.end(), [&prefix](const QString& left, const QString& right) {
+        return RotationOrder(left.mid(prefix.size())) < RotationOrder(right.mid(prefix.size()));
+    });
+    for (const QString& leftover : qAsConst(leftovers))
+        mBackupWorker.start(new ShiftBackupsRunnable(mFileName, directory.filePath(leftover), mBackupsCount, mCompressBackups));
+}
+
+void QsLogging::SizeRotationStrategy::includeMessageInCalculation(qint64 messageSizeInBytes)
+{
+    mCurrentSizeInBytes += messageSizeInBytes;
+}
+
+bool QsLogging::SizeRotationStrategy::shouldRotate()
+{
+    if (rotateOnInit)
+        return true;
+    if (mMaxSizeInBytes > 0 && mCurrentSizeInBytes > mMaxSizeInBytes)
+        return true;
+    return mRotationIntervalInSeconds > 0
+            && mSegmentAgeAtOpenInMs + mSegmentTimer.elapsed() >= mRotationIntervalInSeconds * 1000;
+}
+
+// Only moves the current log out of the way, shifting, pruning and compressing
+// the backups happens on mBackupWorker so the writing thread doesn't wait for it
+void QsLogging::SizeRotationStrategy::rotate()
+{
+    const QString rotatedName = mFileName + QStringLiteral(".rotating.%1.%2")
+            .arg(QDateTime::currentMSecsSinceEpoch())
+            .arg(++mRotationCounter);
+    // cleared even if the rename fails, otherwise every following message would retry it
     rotateOnInit = false;
+    if (!QFile::rename(mFileName, rotatedName)) {
+        std::cerr << "QsLog: could not rename log " << qPrintable(mFileName)
+                  << " to " << qPrintable(rotatedName) << std::endl;
+        mRotationFailed = true;
+        return;
+    }
+    mBackupWorker.start(new ShiftBackupsRunnable(mFileName, rotatedName, mBackupsCount, mCompressBackups));
 }
 
 QIODevice::OpenMode QsLogging::SizeRotationStrategy::recommendedOpenModeFlag()
@@ -119,45 +279,123 @@ void QsLogging::SizeRotationStrategy::setBackupCount(int backups)
     mBackupsCount = qMin(backups, SizeRotationStrategy::MaxBackupCount);
 }
 
+void QsLogging::SizeRotationStrategy::setRotationIntervalInSeconds(int seconds)
+{
+    Q_ASSERT(seconds >= 0);
+    mRotationIntervalInSeconds = seconds;
+}
 
-QsLogging::FileDestination::FileDestination(const QString& filePath, RotationStrategyPtr rotationStrategy)
+void QsLogging::SizeRotationStrategy::setCompressBackups(bool compress)
+{
+    mCompressBackups = compress;
+}
+
+
+QsLogging::FileDestination::FileDestination(const QString& filePath, RotationStrategyPtr rotationStrategy,
+                                            const FlushPolicy& flushPolicy)
     : mRotationStrategy(rotationStrategy)
+    , mFlushPolicy(flushPolicy)
 {
+    // reserve() also makes resize(0) keep the allocation between flushes
+    mBuffer.reserve(static_cast<int>(qMax<qint64>(mFlushPolicy.bufferSizeInBytes, 4096)));
     mFile.setFileName(filePath);
-    if (!mFile.open(QFile::WriteOnly | QFile::Text | mRotationStrategy->recommendedOpenModeFlag()))
-        std::cerr << "QsLog: could not open log file " << qPrintable(filePath) << std::endl;
-
-    mOutputStream.setDevice(&mFile);
-    mOutputStream.setCodec(QTextCodec::codecForName("UTF-8"));
+    openFile();
     mRotationStrategy->setInitialInfo(mFile);
 }
 
+QsLogging::FileDestination::~FileDestination()
+{
+    flush();
+}
+
 void QsLogging::FileDestination::write(const QString& message, Level level, Level currentLoggingLevel)
 {
     if(level < currentLoggingLevel)
         return;
+    write(message, message.toUtf8(), level, currentLoggingLevel);
+}
 
-    mRotationStrategy->includeMessageInCalculation(message);
-    if (mRotationStrategy->shouldRotate())
-    {
-        mOutputStream.setDevice(NULL);
-        mFile.close();
-        mRotationStrategy->rotate();
-        if (!mFile.open(QFile::WriteOnly | QFile::Text | mRotationStrategy->recommendedOpenModeFlag()))
-            std::cerr << "QsLog: could not reopen log file " << qPrintable(mFile.fileName()) << std::endl;
-        mRotationStrategy->setInitialInfo(mFile);
-        mOutputStream.setDevice(&mFile);
-    }
+void QsLogging::FileDestination::write(const QString&, const QByteArray& utf8Message, Level level, Level currentLoggingLevel)
+{
+    if(level < currentLoggingLevel)
+        return;
+
+    rotateIfNeeded(utf8Message.size() + 1);
+    appendLine(utf8Message);
+    flushIfNeeded(level);
+}
+
+void QsLogging::FileDestination::flush()
+{
+    if (mBuffer.isEmpty())
+        return;
+    if (mFile.write(mBuffer) != mBuffer.size())
+        std::cerr << "QsLog: could not write to log file " << qPrintable(mFile.fileName()) << std::endl;
+    mBuffer.resize(0);
+    mSinceFirstUnflushed.invalidate();
+}
+
+void QsLogging::FileDestination::flushExpired()
+{
+    if (!mBuffer.isEmpty() && mSinceFirstUnflushed.elapsed() >= mFlushPolicy.maxDelayInMs)
+        flush();
+}
+
+bool QsLogging::FileDestination::needsTimedFlush() const
+{
+    return mFlushPolicy.bufferSizeInBytes > 0;
+}
+
+bool QsLogging::FileDestination::openFile()
+{
+    // the file is unbuffered, mBuffer is the only buffer between us and the OS
+    // no QFile::Text: lines end in a plain '\n' on every platform so the byte count used for rotation is exact
+    const bool opened = mFile.open(QFile::WriteOnly | QFile::Unbuffered | mRotationStrategy->recommendedOpenModeFlag());
+    if (!opened)
+        std::cerr << "QsLog: could not open log file " << qPrintable(mFile.fileName()) << std::endl;
+    return opened;
+}
+
+void QsLogging::FileDestination::rotateIfNeeded(qint64 incomingSizeInBytes)
+{
+    mRotationStrategy->includeMessageInCalculation(incomingSizeInBytes);
+    if (!mRotationStrategy->shouldRotate())
+        return;
+    rotateNow();
+}
 
-    mOutputStream << message << Qt::endl;
-    mOutputStream.flush();
+void QsLogging::FileDestination::rotateNow()
+{
+    flush();
+    mFile.close();
+    mRotationStrategy->rotate();
+    openFile();
+    mRotationStrategy->setInitialInfo(mFile);
+}
+
+void QsLogging::FileDestination::appendLine(const QByteArray& utf8Message)
+{
+    if (mBuffer.isEmpty())
+        mSinceFirstUnflushed.start();
+    mBuffer.append(utf8Message);
+    mBuffer.append('\n');
+}
+
+void QsLogging::FileDestination::flushIfNeeded(Level level)
+{
+    const bool flushNow = mFlushPolicy.bufferSizeInBytes == 0
+            || level >= mFlushPolicy.immediateLevel
+            || mBuffer.size() >= mFlushPolicy.bufferSizeInBytes
+            || mSinceFirstUnflushed.elapsed() >= mFlushPolicy.maxDelayInMs;
+    if (flushNow)
+        flush();
 }
 
 void QsLogging::FileDestination::close(const QString &message, QsLogging::Level level)
 {
     Q_UNUSED(message)
     Q_UNUSED(level)
-    mOutputStream.setDevice(NULL);
+    flush();
     mFile.close();
 }
 
@@ -169,7 +407,7 @@ bool QsLogging::FileDestination::isValid()
 
 void QsLogging::ErrDumpDestination::write(const QString &message, QsLogging::Level level)
 {
-
+    const QByteArray utf8Message = message.toUtf8();
 
     bool normalWrite = (level != QsLogging::ErrorLevel && level != QsLogging::FatalLevel);
     if(normalWrite)
@@ -177,48 +415,27 @@ void QsLogging::ErrDumpDestination::write(const QString &message, QsLogging::Lev
 
         if(level >= An<QsLogging::Logger>()->loggingLevel())
         {
-            mRotationStrategy->includeMessageInCalculation(message);
-            if (mRotationStrategy->shouldRotate())
-            {
-                mOutputStream.setDevice(NULL);
-                mFile.close();
-                mRotationStrategy->rotate();
-                if (!mFile.open(QFile::WriteOnly | QFile::Text | mRotationStrategy->recommendedOpenModeFlag()))
-                    std::cerr << "QsLog: could not reopen log file " << qPrintable(mFile.fileName()) << std::endl;
-                mRotationStrategy->setInitialInfo(mFile);
-                mOutputStream.setDevice(&mFile);
-            }
-
-
-            mOutputStream << message << Qt::endl;
-            mOutputStream.flush();
+            rotateIfNeeded(utf8Message.size() + 1);
+            appendLine(utf8Message);
+            flushIfNeeded(level);
         }
-        queue.push_back(message);
+        queue.push_back(utf8Message);
     }
     else
     {
-        mRotationStrategy->includeMessageInCalculation(message);
-        if (mRotationStrategy->shouldRotate()) {
-            mOutputStream.setDevice(NULL);
-            mFile.close();
-            mRotationStrategy->rotate();
-            if (!mFile.open(QFile::WriteOnly | QFile::Text | mRotationStrategy->recommendedOpenModeFlag()))
-                std::cerr << "QsLog: could not reopen log file " << qPrintable(mFile.fileName()) << std::endl;
-            mRotationStrategy->setInitialInfo(mFile);
-            mOutputStream.setDevice(&mFile);
-        }
+        rotateIfNeeded(utf8Message.size() + 1);
         bool queueFull = queue.size() > 0;
         if(queueFull)
-            mOutputStream << "Error level triggered, dumping full cycle" << Qt::endl;
-        for(auto& string : qAsConst(queue))
+            appendLine(QByteArrayLiteral("Error level triggered, dumping full cycle"));
+        for(auto& line : qAsConst(queue))
         {
-            mOutputStream << string << Qt::endl;
+            appendLine(line);
         }
-        mOutputStream << message << Qt::endl;
+        appendLine(utf8Message);
         if(queueFull)
-            mOutputStream << "Error level triggered, end of dump" << Qt::endl;
+            appendLine(QByteArrayLiteral("Error level triggered, end of dump"));
         queue.clear();
-        mOutputStream.flush();
+        flush();
     }
 
 }
@@ -231,5 +448,5 @@ void QsLogging::ErrDumpDestination::clearQueue()
 void QsLogging::FileDestination::Rotate()
 {
     if(mRotationStrategy)
-        mRotationStrategy->rotate();
+        rotateNow();
 }
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include "logger/QsLog.h"
+#include "logger/QsLogDest.h"
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Exercises the QS_LOG_SEPARATE_THREAD queue. The product builds the logger sources
+// with a tiny queue so that both overflow policies actually get hit.
+
+using namespace QsLogging;
+
+// counts what reaches it and checks that every producer's messages arrive in order
+// write() is only ever called under the logger lock so plain members are enough
+class CountingDestination: public Destination{
+public:
+    explicit CountingDestination(int producers = 1): lastSequence(producers, -1){}
+
+    void write(const QString& message, Level, Level) override{
+        if(holdWriter.load(std::memory_order_acquire)){
+            writerBlocked.store(true, std::memory_order_release);
+            while(holdWriter.load(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+        if(writeDelay.count() > 0)
+            std::this_thread::sleep_for(writeDelay);
+        const QStringList parts = message.simplified().split(' ');
+        const int producer = parts.value(0).toInt();
+        const int sequence = parts.value(1).toInt();
+        if(sequence <= lastSequence[producer])
+            outOfOrder++;
+        lastSequence[producer] = sequence;
+        received++;
+    }
+    bool isValid() override {return true;}
+    void flush() override {flushed++;}
+
+    std::atomic<bool> holdWriter{false};
+    std::atomic<bool> writerBlocked{false};
+    std::chrono::microseconds writeDelay{0};
+    std::vector<int> lastSequence;
+    int received = 0;
+    int outOfOrder = 0;
+    int flushed = 0;
+};
+
+static void LogFrom(Logger& logger, int producer, int count){
+    for(int i = 0; i < count; i++)
+        Logger::Helper(InfoLevel, &logger, false).stream() << producer << i;
+}
+
+static void RunProducers(Logger& logger, int producers, int messagesPerProducer){
+    std::vector<std::thread> threads;
+    for(int producer = 0; producer < producers; producer++)
+        threads.emplace_back(LogFrom, std::ref(logger), producer, messagesPerProducer);
+    for(auto& thread: threads)
+        thread.join();
+}
+
+TEST(LoggerQueue, BlockOnOverflowDeliversEverything){
+    const int producers = 8;
+    const int messagesPerProducer = 2000;
+    auto destination = QSharedPointer<CountingDestination>::create(producers);
+    // slow enough for the producers to keep running into a full queue
+    destination->writeDelay = std::chrono::microseconds(1);
+    Logger logger;
+    logger.addDestination(destination);
+    logger.setOverflowPolicy(Logger::BlockOnOverflow);
+
+    RunProducers(logger, producers, messagesPerProducer);
+    logger.flush();
+
+    EXPECT_EQ(destination->received, producers * messagesPerProducer);
+    EXPECT_EQ(destination->outOfOrder, 0);
+    EXPECT_EQ(logger.droppedMessageCount(), 0u);
+    EXPECT_GT(destination->flushed, 0);
+}
+
+TEST(LoggerQueue, DropOnOverflowAccountsForEveryMessage){
+    const int producers = 8;
+    const int messagesPerProducer = 1000;
+    auto destination = QSharedPointer<CountingDestination>::create(producers);
+    Logger logger;
+    logger.addDestination(destination);
+    logger.setOverflowPolicy(Logger::DropOnOverflow);
+
+    // park the writer inside the destination so the queue is guaranteed to fill up
+    destination->holdWriter.store(true);
+    LogFrom(logger, 0, 1);
+    while(!destination->writerBlocked.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    RunProducers(logger, producers, messagesPerProducer);
+    destination->holdWriter.store(false, std::memory_order_release);
+    logger.flush();
+
+    const quint64 dropped = logger.droppedMessageCount();
+    EXPECT_GT(dropped, 0u);
+    EXPECT_EQ(destination->received + dropped, quint64(producers * messagesPerProducer + 1));
+    EXPECT_EQ(destination->outOfOrder, 0);
+}
+
+TEST(LoggerQueue, FlushWaitsForQueuedMessages){
+    auto destination = QSharedPointer<CountingDestination>::create();
+    destination->writeDelay = std::chrono::microseconds(200);
+    Logger logger;
+    logger.addDestination(destination);
+
+    LogFrom(logger, 0, 500);
+    logger.flush();
+    EXPECT_EQ(destination->received, 500);
+    EXPECT_GT(destination->flushed, 0);
+}
+
+TEST(LoggerQueue, FlushGivesUpOnStuckDestination){
+    auto destination = QSharedPointer<CountingDestination>::create();
+    Logger logger;
+    logger.addDestination(destination);
+
+    destination->holdWriter.store(true);
+    LogFrom(logger, 0, 2);
+    while(!destination->writerBlocked.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    EXPECT_FALSE(logger.flush(50));
+    destination->holdWriter.store(false, std::memory_order_release);
+    EXPECT_TRUE(logger.flush());
+    EXPECT_EQ(destination->received, 2);
+}
+
+TEST(LoggerQueue, DestructionDrainsTheQueue){
+    const int producers = 4;
+    const int messagesPerProducer = 2000;
+    auto destination = QSharedPointer<CountingDestination>::create(producers);
+    destination->writeDelay = std::chrono::microseconds(1);
+    {
+        Logger logger;
+        logger.addDestination(destination);
+        RunProducers(logger, producers, messagesPerProducer);
+    }
+    EXPECT_EQ(destination->received, producers * messagesPerProducer);
+    EXPECT_EQ(destination->outOfOrder, 0);
+}
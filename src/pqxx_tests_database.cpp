@@ -108,3 +108,63 @@ TEST_F(DatabaseTestPQXX, EnsureNamedValuesSelectWorksForPG){
 
 
 }
+
+TEST_F(DatabaseTestPQXX, DbPerformTransaction){
+    auto db = sql::Database::addDatabase("PQXX", "TestPostgresDatabase");
+    db.setConnectionToken(pgToken);
+    auto opened = db.open();
+    ASSERT_EQ(opened, true)  << "Couldn't open the sql database when it was supposed to open just fine from a token";
+    sql::Query q(db);
+    q.prepare("drop table if exists tests.TEST_TRANSACTION_TABLE");
+    q.exec();
+    q.prepare("create table tests.TEST_TRANSACTION_TABLE(test_key integer, test_string_value varchar, test_date_value varchar)");
+    auto result = q.exec();
+    EXPECT_EQ(result, true);
+
+    auto testDate = QDateTime::fromString("1981-07-21 09:00", "yyyy-MM-dd mm:ss");
+    auto fillWithData = [&](){
+        q.prepare("Insert into tests.TEST_TRANSACTION_TABLE(test_key, test_string_value, test_date_value)  values(:key, :value, :date)");
+        q.bindValue("key", 1);
+        q.bindValue("value", "some value");
+        q.bindValue("date", testDate);
+        result = q.exec();
+    };
+    auto readAvailable = [&]()-> bool{
+        q.prepare("SELECT test_key, test_string_value, test_date_value FROM tests.TEST_TRANSACTION_TABLE");
+        q.exec();
+        return q.next();
+    };
+
+    EXPECT_FALSE(db.hasOpenTransaction());
+    db.transaction();
+    EXPECT_TRUE(db.hasOpenTransaction());
+    fillWithData();
+    EXPECT_EQ(result, true);
+    db.rollback();
+    EXPECT_FALSE(db.hasOpenTransaction());
+    result = readAvailable();
+    EXPECT_EQ(result, false);
+
+    // a server side error aborts the transaction in postgres
+    // rollback has to leave the connection usable for the next one
+    db.transaction();
+    fillWithData();
+    EXPECT_FALSE(q.prepare("@#$^@#$"));
+    db.rollback();
+    EXPECT_FALSE(db.hasOpenTransaction());
+    result = readAvailable();
+    EXPECT_EQ(result, false);
+
+    db.transaction();
+    fillWithData();
+    db.commit();
+    EXPECT_FALSE(db.hasOpenTransaction());
+
+    result = readAvailable();
+    EXPECT_EQ(result, true);
+    EXPECT_EQ(q.value("test_key").toInt() == 1, true) << "actually received: " << q.value("test_key").toInt() ;
+    EXPECT_EQ(q.value("test_string_value").toString() == "some value", true);
+
+    q.prepare("drop table if exists tests.TEST_TRANSACTION_TABLE");
+    q.exec();
+}
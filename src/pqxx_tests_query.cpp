@@ -2,56 +2,28 @@
 #include "sql_abstractions/sql_database.h"
 #include "sql_abstractions/sql_query.h"
 #include "sql_abstractions/sql_error.h"
+#include "seeded_test_fixture.h"
 #include <QFileInfo>
 #include <QFile>
 #include <QDate>
 #include <QSettings>
 
 
-struct TestTableData{
-    TestTableData(int key,std::string value,QDateTime date):key(key), value(value), date(date){}
-    bool operator==(const TestTableData& other) const{
-        return this->key == other.key &&
-                this->value == other.value &&
-                this->date == other.date;
-    };
-    int key;
-    std::string value;
-    QDateTime date;
-};
-
-class QueryTestsPQXX: public ::testing::Test{
-protected:
-    QueryTestsPQXX(){
-        db = sql::Database::addDatabase("PQXX", testDatabaseName);
-        QSettings settings("postgres_coordinates.ini", QSettings::IniFormat);
-        pgToken.tokenType = "PQXX";
-        pgToken.ip = settings.value("test.postgres/hostname").toString().toStdString();
-        pgToken.port= settings.value("test.postgres/port").toInt();
-        pgToken.user = settings.value("test.postgres/user").toString().toStdString();
-        pgToken.password = settings.value("test.postgres/pass").toString().toStdString();
-        db.setConnectionToken(pgToken);
-        db.open();
-
-        testTableData.emplace_back(1, "some value", QDateTime::fromString("1981-07-22 09:00", "yyyy-MM-dd mm:ss"));
-        testTableData.emplace_back(2, "some other value", QDateTime::fromString("1981-07-21 09:00", "yyyy-MM-dd mm:ss"));
-        CreateSchemaForTesting();
-    }
+class QueryTestsPQXX: public SeededDatabaseTest<QueryTestsPQXX>{
+public:
+    static sql::ConnectionToken TestConnectionToken();
+    static void CreateSchemaForTesting(sql::Database db);
+    static void DropTestingSchema(sql::Database db);
 
-    void TearDown() override {
-        DropTestingSchema();
-        db = {};
-        sql::Database::removeDatabase(testDatabaseName);
-    }
-    void CreateSchemaForTesting();
-    void DropTestingSchema();
-
-    std::string testDatabaseName = "TestPqxxDatabase";
-    sql::ConnectionToken pgToken;
-    sql::Database db;
-    std::vector<TestTableData> testTableData;
+    static std::string testDatabaseName;
+    static std::string testTableName;
+    static std::string driverType;
 };
 
+std::string QueryTestsPQXX::testDatabaseName = "TestPqxxDatabase";
+std::string QueryTestsPQXX::testTableName = "dynamic_test_data.TEST_CREATE_TABLE";
+std::string QueryTestsPQXX::driverType = "PQXX";
+
 
 TEST_F(QueryTestsPQXX, EmptyObjectTest){
     // initialization with null database
@@ -218,7 +190,19 @@ TEST_F(QueryTestsPQXX, AlternativeConstructor){
     EXPECT_TRUE(data == testTableData[0]);
 }
 
-void QueryTestsPQXX::CreateSchemaForTesting()
+sql::ConnectionToken QueryTestsPQXX::TestConnectionToken()
+{
+    sql::ConnectionToken pgToken;
+    QSettings settings("postgres_coordinates.ini", QSettings::IniFormat);
+    pgToken.tokenType = "PQXX";
+    pgToken.ip = settings.value("test.postgres/hostname").toString().toStdString();
+    pgToken.port= settings.value("test.postgres/port").toInt();
+    pgToken.user = settings.value("test.postgres/user").toString().toStdString();
+    pgToken.password = settings.value("test.postgres/pass").toString().toStdString();
+    return pgToken;
+}
+
+void QueryTestsPQXX::CreateSchemaForTesting(sql::Database db)
 {
     sql::Query q(db);
     q.prepare("create schema if not exists dynamic_test_data");
@@ -226,19 +210,11 @@ void QueryTestsPQXX::CreateSchemaForTesting()
     q.prepare("create table if not exists dynamic_test_data.TEST_CREATE_TABLE(test_key integer, test_string_value varchar, test_date_value varchar)");
     q.exec();
     q.lastError();
-
-    q.prepare("Insert into dynamic_test_data.TEST_CREATE_TABLE(test_key, test_string_value, test_date_value)  values(:key, :value, :date)");
-    for(const auto& data: testTableData){
-        q.bindValue("key", data.key);
-        q.bindValue("value", data.value);
-        q.bindValue("date", data.date);
-        q.exec();
-    }
 }
 
-void QueryTestsPQXX::DropTestingSchema()
+void QueryTestsPQXX::DropTestingSchema(sql::Database db)
 {
     sql::Query q(db);
-    q.prepare("drop schema dynamic_test_data cascade");
+    q.prepare("drop schema if exists dynamic_test_data cascade");
     q.exec();
 }
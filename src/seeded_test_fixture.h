@@ -0,0 +1,104 @@
+#pragma once
+#include <gtest/gtest.h>
+#include "sql_abstractions/sql_database.h"
+#include "sql_abstractions/sql_query.h"
+#include <QDateTime>
+#include <string>
+#include <vector>
+
+
+struct TestTableData{
+    TestTableData(int key,std::string value,QDateTime date):key(key), value(value), date(date){}
+    bool operator==(const TestTableData& other) const{
+        return this->key == other.key &&
+                this->value == other.value &&
+                this->date == other.date;
+    };
+    int key;
+    std::string value;
+    QDateTime date;
+};
+
+inline std::vector<TestTableData> SeedTableData(){
+    std::vector<TestTableData> result;
+    result.emplace_back(1, "some value", QDateTime::fromString("1981-07-22 09:00", "yyyy-MM-dd mm:ss"));
+    result.emplace_back(2, "some other value", QDateTime::fromString("1981-07-21 09:00", "yyyy-MM-dd mm:ss"));
+    return result;
+}
+
+// Creates the test table and seeds it once per test suite instead of once per test.
+// Every test runs inside a transaction that is rolled back in TearDown
+// so whatever a test writes never leaks into the next one.
+// Derived has to provide:
+//   static std::string testDatabaseName;
+//   static std::string testTableName;
+//   static std::string driverType;
+//   static sql::ConnectionToken TestConnectionToken();
+//   static void CreateSchemaForTesting(sql::Database db);
+//   static void DropTestingSchema(sql::Database db); // must succeed when there is nothing to drop
+template<typename Derived>
+class SeededDatabaseTest: public ::testing::Test{
+public:
+    static void SetUpTestSuite(){
+        suiteReady = false;
+        auto db = sql::Database::addDatabase(Derived::driverType, Derived::testDatabaseName);
+        db.setConnectionToken(Derived::TestConnectionToken());
+        if(!db.open()){
+            ADD_FAILURE() << "Couldn't open " << Derived::testDatabaseName << ", every test in the suite will fail";
+            return;
+        }
+        // a run that crashed before TearDownTestSuite leaves its seed rows behind
+        // and they would be counted twice by every test
+        Derived::DropTestingSchema(db);
+
+        db.transaction();
+        Derived::CreateSchemaForTesting(db);
+        sql::Query q(db);
+        q.prepare("Insert into " + Derived::testTableName + "(test_key, test_string_value, test_date_value)  values(:key, :value, :date)");
+        for(const auto& data: SeedTableData()){
+            q.bindValue("key", data.key);
+            q.bindValue("value", data.value);
+            q.bindValue("date", data.date);
+            if(!q.exec()){
+                ADD_FAILURE() << "Couldn't seed " << Derived::testTableName;
+                db.rollback();
+                return;
+            }
+        }
+        if(!db.commit()){
+            ADD_FAILURE() << "Couldn't commit the seed data for " << Derived::testTableName;
+            return;
+        }
+        suiteReady = true;
+    }
+
+    static void TearDownTestSuite(){
+        {
+            auto db = sql::Database::database(Derived::testDatabaseName);
+            Derived::DropTestingSchema(db);
+        }
+        sql::Database::removeDatabase(Derived::testDatabaseName);
+    }
+
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(suiteReady) << "Test table wasn't seeded, see the failure reported by SetUpTestSuite";
+        db = sql::Database::database(Derived::testDatabaseName);
+        db.transaction();
+        // without an open transaction rollback in TearDown does nothing
+        // and whatever the test writes ends up in the next one
+        ASSERT_TRUE(db.hasOpenTransaction());
+    }
+
+    void TearDown() override {
+        if(db.hasOpenTransaction())
+            db.rollback();
+        db = {};
+    }
+
+    sql::Database db;
+    std::vector<TestTableData> testTableData = SeedTableData();
+
+private:
+    inline static bool suiteReady = false;
+};
@@ -0,0 +1,361 @@
+#include <benchmark/benchmark.h>
+#include "sql_abstractions/sql_database.h"
+#include "sql_abstractions/sql_query.h"
+#include "sql_abstractions/sql_error.h"
+#include <QFile>
+#include <QSettings>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Measures the overhead of the sql wrapper itself for both drivers.
+// Every benchmark that touches data takes two arguments: row count and column count of the table it reads.
+// Output defaults to JSON, pass --benchmark_format=console to override
+
+struct BackendSqlite{
+    static constexpr const char* driverType = "QSQLITE";
+    static constexpr const char* databaseName = "BenchSqliteDatabase";
+    static constexpr const char* databaseFile = "benchdb.sqlite";
+    static constexpr const char* tablePrefix = "";
+
+    static sql::ConnectionToken Token(){
+        return sql::ConnectionToken (databaseFile, "test_db_init.sql", "");
+    }
+    static bool CreateSchema(sql::Database){return true;}
+    static void Cleanup(sql::Database){}
+    static void RemoveFiles(){
+        QFile::remove(databaseFile);
+    }
+};
+
+struct BackendPQXX{
+    static constexpr const char* driverType = "PQXX";
+    static constexpr const char* databaseName = "BenchPqxxDatabase";
+    static constexpr const char* tablePrefix = "bench_data.";
+
+    static sql::ConnectionToken Token(){
+        sql::ConnectionToken pgToken;
+        QSettings settings("postgres_coordinates.ini", QSettings::IniFormat);
+        pgToken.tokenType = "PQXX";
+        pgToken.ip = settings.value("test.postgres/hostname").toString().toStdString();
+        pgToken.port= settings.value("test.postgres/port").toInt();
+        pgToken.user = settings.value("test.postgres/user").toString().toStdString();
+        pgToken.password = settings.value("test.postgres/pass").toString().toStdString();
+        return pgToken;
+    }
+    static bool CreateSchema(sql::Database db){
+        sql::Query q("create schema if not exists bench_data", db);
+        return q.exec() && q.lastError() == sql::Error::noError();
+    }
+    static void Cleanup(sql::Database db){
+        sql::Query q("drop schema if exists bench_data cascade", db);
+        q.exec();
+    }
+    static void RemoveFiles(){}
+};
+
+static std::string ColumnName(int column){
+    return "value_" + std::to_string(column);
+}
+
+static bool ExecSucceeded(sql::Query& q){
+    return q.exec() && q.lastError() == sql::Error::noError();
+}
+
+// one connection per backend for the whole run, opened on first use and released from main()
+// every rows x columns table is created and filled once, google benchmark calls
+// each benchmark function several times per argument set and they all reuse it
+template<typename Backend>
+class BenchDatabase{
+public:
+    struct Table{
+        std::string selectQuery;
+        std::string error;
+    };
+
+    static BenchDatabase& Instance(){
+        if(!holder)
+            holder.reset(new BenchDatabase());
+        return *holder;
+    }
+    static void Release(){
+        holder.reset();
+    }
+
+    ~BenchDatabase(){
+        if(opened)
+            Backend::Cleanup(db);
+        db = {};
+        sql::Database::removeDatabase(Backend::databaseName);
+        Backend::RemoveFiles();
+    }
+
+    // error is set when the table couldn't be created, benchmarks skip themselves with it
+    const Table& GetTable(int rows, int columns){
+        auto it = tables.find({rows, columns});
+        if(it != tables.end())
+            return it->second;
+        Table& table = tables[{rows, columns}];
+        if(!error.empty())
+            table.error = error;
+        else if(!CreateTable(rows, columns, table))
+            table.error = "couldn't create or fill the benchmark table";
+        return table;
+    }
+
+    std::string error;
+    sql::Database db;
+    bool opened = false;
+
+private:
+    BenchDatabase(){
+        db = sql::Database::addDatabase(Backend::driverType, Backend::databaseName);
+        db.setConnectionToken(Backend::Token());
+        opened = db.open();
+        if(!opened)
+            error = "couldn't open the database";
+        else if(!Backend::CreateSchema(db))
+            error = "couldn't create the benchmark schema";
+    }
+
+    bool CreateTable(int rows, int columns, Table& table){
+        const std::string tableName = std::string(Backend::tablePrefix) + "bench_table_"
+                + std::to_string(rows) + "_" + std::to_string(columns);
+        std::string columnList;
+        std::string bindList;
+        std::string columnDefinitions;
+        for(int i = 0; i < columns; i++){
+            if(i > 0){
+                columnList += ", ";
+                bindList += ", ";
+                columnDefinitions += ", ";
+            }
+            columnList += ColumnName(i);
+            bindList += ":" + ColumnName(i);
+            columnDefinitions += ColumnName(i) + " varchar";
+        }
+        sql::Query q(db);
+        q.prepare("drop table if exists " + tableName);
+        if(!ExecSucceeded(q))
+            return false;
+        q.prepare("create table " + tableName + "(" + columnDefinitions + ")");
+        if(!ExecSucceeded(q))
+            return false;
+
+        db.transaction();
+        q.prepare("insert into " + tableName + "(" + columnList + ") values(" + bindList + ")");
+        for(int row = 0; row < rows; row++){
+            for(int i = 0; i < columns; i++)
+                q.bindValue(ColumnName(i), "cell " + std::to_string(row));
+            if(!ExecSucceeded(q)){
+                db.rollback();
+                return false;
+            }
+        }
+        if(!db.commit())
+            return false;
+        table.selectQuery = "select " + columnList + " from " + tableName;
+        return true;
+    }
+
+    std::map<std::pair<int, int>, Table> tables;
+    static std::unique_ptr<BenchDatabase> holder;
+};
+
+template<typename Backend>
+std::unique_ptr<BenchDatabase<Backend>> BenchDatabase<Backend>::holder;
+
+template<typename Backend>
+static void BM_AddDatabaseAndOpen(benchmark::State& state){
+    // separate connection name, the shared one stays open for the other benchmarks
+    const std::string connectionName = std::string(Backend::databaseName) + "Open";
+    for(auto _ : state){
+        auto db = sql::Database::addDatabase(Backend::driverType, connectionName);
+        db.setConnectionToken(Backend::Token());
+        if(!db.open()){
+            state.SkipWithError("couldn't open the database");
+            break;
+        }
+        db = {};
+        sql::Database::removeDatabase(connectionName);
+    }
+    sql::Database::removeDatabase(connectionName);
+}
+
+template<typename Backend>
+static void BM_Prepare(benchmark::State& state){
+    auto& bench = BenchDatabase<Backend>::Instance();
+    const auto& table = bench.GetTable(1, state.range(1));
+    if(!table.error.empty()){
+        state.SkipWithError(table.error.c_str());
+        return;
+    }
+    sql::Query q(bench.db);
+    if(!q.prepare(table.selectQuery)){
+        state.SkipWithError("prepare failed");
+        return;
+    }
+    for(auto _ : state)
+        benchmark::DoNotOptimize(q.prepare(table.selectQuery));
+}
+
+template<typename Backend>
+static void BM_Exec(benchmark::State& state){
+    auto& bench = BenchDatabase<Backend>::Instance();
+    const auto& table = bench.GetTable(state.range(0), state.range(1));
+    if(!table.error.empty()){
+        state.SkipWithError(table.error.c_str());
+        return;
+    }
+    sql::Query q(bench.db);
+    q.prepare(table.selectQuery);
+    // timing the failure path would still produce perfectly valid looking numbers
+    if(!ExecSucceeded(q)){
+        state.SkipWithError("exec failed");
+        return;
+    }
+    for(auto _ : state)
+        benchmark::DoNotOptimize(q.exec());
+}
+
+// The benchmarks below time exec() together with reading the result, pausing the timer
+// around exec() on every iteration costs more than reading a 10 row result.
+// Subtract BM_Exec for the same arguments to get the reading part alone.
+template<typename Backend>
+static void BM_Next(benchmark::State& state){
+    auto& bench = BenchDatabase<Backend>::Instance();
+    const auto& table = bench.GetTable(state.range(0), state.range(1));
+    if(!table.error.empty()){
+        state.SkipWithError(table.error.c_str());
+        return;
+    }
+    sql::Query q(bench.db);
+    q.prepare(table.selectQuery);
+    for(auto _ : state){
+        if(!ExecSucceeded(q)){
+            state.SkipWithError("exec failed");
+            break;
+        }
+        while(q.next())
+            benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<typename Backend>
+static void BM_ValueByIndex(benchmark::State& state){
+    auto& bench = BenchDatabase<Backend>::Instance();
+    const auto& table = bench.GetTable(state.range(0), state.range(1));
+    if(!table.error.empty()){
+        state.SkipWithError(table.error.c_str());
+        return;
+    }
+    const int columns = state.range(1);
+    sql::Query q(bench.db);
+    q.prepare(table.selectQuery);
+    for(auto _ : state){
+        if(!ExecSucceeded(q)){
+            state.SkipWithError("exec failed");
+            break;
+        }
+        while(q.next()){
+            for(int i = 0; i < columns; i++)
+                benchmark::DoNotOptimize(q.value(i).toString());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * columns);
+}
+
+template<typename Backend>
+static void BM_ValueByName(benchmark::State& state){
+    auto& bench = BenchDatabase<Backend>::Instance();
+    const auto& table = bench.GetTable(state.range(0), state.range(1));
+    if(!table.error.empty()){
+        state.SkipWithError(table.error.c_str());
+        return;
+    }
+    std::vector<std::string> columnNames;
+    for(int i = 0; i < state.range(1); i++)
+        columnNames.push_back(ColumnName(i));
+
+    sql::Query q(bench.db);
+    q.prepare(table.selectQuery);
+    for(auto _ : state){
+        if(!ExecSucceeded(q)){
+            state.SkipWithError("exec failed");
+            break;
+        }
+        while(q.next()){
+            for(const auto& name: columnNames)
+                benchmark::DoNotOptimize(q.value(name).toString());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(1));
+}
+
+template<typename Backend>
+static void BM_BindValue(benchmark::State& state){
+    auto& bench = BenchDatabase<Backend>::Instance();
+    const auto& table = bench.GetTable(1, state.range(1));
+    if(!table.error.empty()){
+        state.SkipWithError(table.error.c_str());
+        return;
+    }
+    std::vector<std::string> columnNames;
+    for(int i = 0; i < state.range(1); i++)
+        columnNames.push_back(ColumnName(i));
+
+    sql::Query q(bench.db);
+    std::string where;
+    for(const auto& name: columnNames)
+        where += (where.empty() ? " where " : " and ") + name + " = :" + name;
+    q.prepare(table.selectQuery + where);
+    const std::string value = "cell 0";
+    for(auto _ : state){
+        for(const auto& name: columnNames)
+            q.bindValue(name, value);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+static void RowsAndColumns(benchmark::internal::Benchmark* b){
+    b->ArgNames({"rows", "columns"})->ArgsProduct({{10, 1000, 10000}, {1, 8, 32}});
+}
+
+static void ColumnsOnly(benchmark::internal::Benchmark* b){
+    b->ArgNames({"rows", "columns"})->ArgsProduct({{1}, {1, 8, 32}});
+}
+
+BENCHMARK_TEMPLATE(BM_AddDatabaseAndOpen, BackendSqlite);
+BENCHMARK_TEMPLATE(BM_AddDatabaseAndOpen, BackendPQXX);
+BENCHMARK_TEMPLATE(BM_Prepare, BackendSqlite)->Apply(ColumnsOnly);
+BENCHMARK_TEMPLATE(BM_Prepare, BackendPQXX)->Apply(ColumnsOnly);
+BENCHMARK_TEMPLATE(BM_Exec, BackendSqlite)->Apply(RowsAndColumns);
+BENCHMARK_TEMPLATE(BM_Exec, BackendPQXX)->Apply(RowsAndColumns);
+BENCHMARK_TEMPLATE(BM_Next, BackendSqlite)->Apply(RowsAndColumns);
+BENCHMARK_TEMPLATE(BM_Next, BackendPQXX)->Apply(RowsAndColumns);
+BENCHMARK_TEMPLATE(BM_ValueByIndex, BackendSqlite)->Apply(RowsAndColumns);
+BENCHMARK_TEMPLATE(BM_ValueByIndex, BackendPQXX)->Apply(RowsAndColumns);
+BENCHMARK_TEMPLATE(BM_ValueByName, BackendSqlite)->Apply(RowsAndColumns);
+BENCHMARK_TEMPLATE(BM_ValueByName, BackendPQXX)->Apply(RowsAndColumns);
+BENCHMARK_TEMPLATE(BM_BindValue, BackendSqlite)->Apply(ColumnsOnly);
+BENCHMARK_TEMPLATE(BM_BindValue, BackendPQXX)->Apply(ColumnsOnly);
+
+int main(int argc, char** argv){
+    // json goes first so that an explicit --benchmark_format on the command line wins
+    std::string jsonFormat = "--benchmark_format=json";
+    std::vector<char*> arguments(argv, argv + argc);
+    arguments.insert(arguments.begin() + 1, jsonFormat.data());
+    int argumentCount = static_cast<int>(arguments.size());
+    benchmark::Initialize(&argumentCount, arguments.data());
+    if(benchmark::ReportUnrecognizedArguments(argumentCount, arguments.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    // drops the benchmark tables and closes the shared connections
+    BenchDatabase<BackendSqlite>::Release();
+    BenchDatabase<BackendPQXX>::Release();
+    benchmark::Shutdown();
+    return 0;
+}
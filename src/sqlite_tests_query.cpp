@@ -2,50 +2,39 @@
 #include "sql_abstractions/sql_database.h"
 #include "sql_abstractions/sql_query.h"
 #include "sql_abstractions/sql_error.h"
+#include "seeded_test_fixture.h"
 #include <QFileInfo>
 #include <QFile>
 #include <QDate>
 #include <QSettings>
 
 
-struct TestTableData{
-    TestTableData(int key,std::string value,QDateTime date):key(key), value(value), date(date){}
-    bool operator==(const TestTableData& other) const{
-        return this->key == other.key &&
-                this->value == other.value &&
-                this->date == other.date;
-    };
-    int key;
-    std::string value;
-    QDateTime date;
-};
-
-class QueryTestsSqlite: public ::testing::Test{
-protected:
-    QueryTestsSqlite(){
-        sqliteToken = sql::ConnectionToken ("testdb.sqlite", "test_db_init.sql", "");
-        db = sql::Database::addDatabase("QSQLITE", testDatabaseName);;
-        db.setConnectionToken(sqliteToken);
-        db.open();
-        testTableData.emplace_back(1, "some value", QDateTime::fromString("1981-07-22 09:00", "yyyy-MM-dd mm:ss"));
-        testTableData.emplace_back(2, "some other value", QDateTime::fromString("1981-07-21 09:00", "yyyy-MM-dd mm:ss"));
-        CreateDatabaseForTesting();
+class QueryTestsSqlite: public SeededDatabaseTest<QueryTestsSqlite>{
+public:
+    static void SetUpTestSuite(){
+        // anything left over from a crashed run goes away with the file
+        QFile::remove(QString::fromStdString(sqliteDatabaseFile));
+        SeededDatabaseTest<QueryTestsSqlite>::SetUpTestSuite();
     }
-
-    void TearDown() override {
-        db = {};
-        sql::Database::removeDatabase(testDatabaseName);
+    static void TearDownTestSuite(){
+        SeededDatabaseTest<QueryTestsSqlite>::TearDownTestSuite();
         QFile::remove(QString::fromStdString(sqliteDatabaseFile));
     }
-    void CreateDatabaseForTesting();
-
-    std::string sqliteDatabaseFile = "testdb.sqlite";
-    std::string testDatabaseName = "TestSqliteDatabase";
-    sql::ConnectionToken sqliteToken;
-    sql::Database db;
-    std::vector<TestTableData> testTableData;
+    static sql::ConnectionToken TestConnectionToken();
+    static void CreateSchemaForTesting(sql::Database db);
+    static void DropTestingSchema(sql::Database db);
+
+    static std::string sqliteDatabaseFile;
+    static std::string testDatabaseName;
+    static std::string testTableName;
+    static std::string driverType;
 };
 
+std::string QueryTestsSqlite::sqliteDatabaseFile = "testdb.sqlite";
+std::string QueryTestsSqlite::testDatabaseName = "TestSqliteDatabase";
+std::string QueryTestsSqlite::testTableName = "TEST_CREATE_TABLE";
+std::string QueryTestsSqlite::driverType = "QSQLITE";
+
 
 TEST_F(QueryTestsSqlite, EmptyObjectTest){
     // initialization with null database
@@ -216,21 +205,22 @@ TEST_F(QueryTestsSqlite, AlternativeConstructor){
     EXPECT_TRUE(data == testTableData[0]);
 }
 
-void QueryTestsSqlite::CreateDatabaseForTesting()
+sql::ConnectionToken QueryTestsSqlite::TestConnectionToken()
+{
+    return sql::ConnectionToken (sqliteDatabaseFile, "test_db_init.sql", "");
+}
+
+void QueryTestsSqlite::CreateSchemaForTesting(sql::Database db)
 {
     sql::Query q(db);
     q.prepare("create table if not exists TEST_CREATE_TABLE(test_key integer, test_string_value varchar, test_date_value varchar)");
     q.exec();
     q.lastError();
+}
 
-    q.prepare("Insert into TEST_CREATE_TABLE(test_key, test_string_value, test_date_value)  values(:key, :value, :date)");
-    for(const auto& data: testTableData){
-        q.bindValue("key", data.key);
-        q.bindValue("value", data.value);
-        q.bindValue("date", data.date);
-        q.exec();
-        sql::Error error;
-        error = q.lastError();
-        error = q.lastError();
-    }
+void QueryTestsSqlite::DropTestingSchema(sql::Database db)
+{
+    sql::Query q(db);
+    q.prepare("drop table if exists TEST_CREATE_TABLE");
+    q.exec();
 }